@@ -0,0 +1,456 @@
+// analytics.cpp
+// Time-bucketed occupancy analytics for logread --histogram.
+// The verified log is decoded once into columns (time, actor, room,
+// delta); the kernels then work on plain integer arrays instead of
+// per-line string maps, and the occupancy pass is split across threads
+// by time range.
+
+#include "analytics.h"
+#include "security_utils.h"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <cstring>
+#include <ctime>
+
+// refuse dense tables bigger than this many [bucket][room] cells
+static const size_t MAX_HISTOGRAM_CELLS = size_t(1) << 26;
+static const size_t DWELL_BINS = 64;
+// largest actor x room presence bitmap used while decoding (8 MiB)
+static const size_t MAX_PRESENCE_BITS = size_t(1) << 26;
+
+// --------------------------
+// time helpers
+// --------------------------
+// days since 1970-01-01 for a proleptic Gregorian date
+static int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= (m <= 2);
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = (unsigned)(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+// reject e.g. Feb 31 instead of letting it roll into March
+static unsigned daysInMonth(unsigned y, unsigned m) {
+    static const unsigned days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    return (m == 2 && leap) ? 29 : days[m - 1];
+}
+
+// parse n fixed-width digits at s[pos]
+static bool digits(std::string_view s, size_t pos, size_t n, unsigned &out) {
+    out = 0;
+    for (size_t i = pos; i < pos + n; ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        out = out * 10 + (unsigned)(s[i] - '0');
+    }
+    return true;
+}
+
+bool parseTimestampSeconds(std::string_view ts, int64_t &out) {
+    // same shape isValidTimestamp() accepts, without the regex cost
+    if (ts.size() != 20 || ts[4] != '-' || ts[7] != '-' || ts[10] != 'T' ||
+        ts[13] != ':' || ts[16] != ':' || ts[19] != 'Z') {
+        return false;
+    }
+    unsigned y, mo, d, h, mi, se;
+    if (!digits(ts, 0, 4, y)  || !digits(ts, 5, 2, mo) || !digits(ts, 8, 2, d) ||
+        !digits(ts, 11, 2, h) || !digits(ts, 14, 2, mi) || !digits(ts, 17, 2, se)) {
+        return false;
+    }
+    if (mo < 1 || mo > 12 || d < 1 || d > daysInMonth(y, mo) ||
+        h > 23 || mi > 59 || se > 60) {
+        return false;
+    }
+    out = daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + se;
+    return true;
+}
+
+std::string formatTimestampSeconds(int64_t t) {
+    std::time_t tt = (std::time_t)t;
+    std::tm tmv;
+    char buf[64];
+    gmtime_r(&tt, &tmv);
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tmv);
+    return std::string(buf);
+}
+
+int64_t parseBucketSpec(const std::string &spec) {
+    if (spec.size() < 2 || spec.size() > 8) return 0;
+    int64_t unit = 0;
+    switch (spec.back()) {
+        case 's': unit = 1;     break;
+        case 'm': unit = 60;    break;
+        case 'h': unit = 3600;  break;
+        case 'd': unit = 86400; break;
+        default:  return 0;
+    }
+    int64_t n = 0;
+    for (size_t i = 0; i + 1 < spec.size(); ++i) {
+        if (spec[i] < '0' || spec[i] > '9') return 0;
+        n = n * 10 + (spec[i] - '0');
+    }
+    return n * unit;
+}
+
+// --------------------------
+// decode: lines -> columns
+// Field values are taken as views into the (already verified) lines,
+// and names are interned by view, so decoding allocates only when a
+// new actor or room first appears.
+// --------------------------
+typedef std::unordered_map<std::string_view, uint32_t> InternTable;
+
+// the event fields of one line, as views into it
+struct EventFields {
+    std::string_view actor, action, room, time;
+};
+
+// One left-to-right pass over the "key":"value" pairs, stopping at
+// "prev" so the two 64-char hashes are never scanned. Rotation records
+// leave actor empty.
+static void scanFields(const std::string &line, EventFields &f) {
+    f = EventFields();
+    const char *p   = line.data();
+    const char *end = p + line.size();
+    while (p < end) {
+        const char *k = (const char*)std::memchr(p, '"', end - p);
+        if (!k) return;
+        const char *ke = (const char*)std::memchr(k + 1, '"', end - k - 1);
+        if (!ke || end - ke < 3 || ke[1] != ':' || ke[2] != '"') return;
+        const char *v  = ke + 3;
+        const char *ve = (const char*)std::memchr(v, '"', end - v);
+        if (!ve) return;
+
+        std::string_view key(k + 1, ke - k - 1), val(v, ve - v);
+        if      (key == "actor")  f.actor  = val;
+        else if (key == "action") f.action = val;
+        else if (key == "room")   f.room   = val;
+        else if (key == "time")   f.time   = val;
+        else if (key == "prev")   return;
+        p = ve + 1;
+    }
+}
+
+// the view's storage (a log line) outlives the table
+static uint32_t intern(InternTable &ids, std::vector<std::string> &names,
+                       std::string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    uint32_t id = (uint32_t)names.size();
+    ids.emplace(name, id);
+    names.emplace_back(name);
+    return id;
+}
+
+// reorder every column by `order`
+template <typename T>
+static void permute(std::vector<T> &col, const std::vector<size_t> &order) {
+    std::vector<T> tmp(col.size());
+    for (size_t i = 0; i < order.size(); ++i) tmp[i] = col[order[i]];
+    col.swap(tmp);
+}
+
+static uint64_t visitKey(uint32_t actor, uint32_t room) {
+    return ((uint64_t)actor << 32) | room;
+}
+
+void decodeEvents(const std::vector<std::string> &lines, EventColumns &out) {
+    out = EventColumns();
+    out.time.reserve(lines.size());
+    out.actor.reserve(lines.size());
+    out.room.reserve(lines.size());
+    out.delta.reserve(lines.size());
+
+    InternTable actorIds, roomIds;
+    EventFields f;
+    for (const std::string &line : lines) {
+        scanFields(line, f);
+        if (f.actor.empty()) continue; // key rotation record
+
+        // logappend only checks the timestamp's shape, so a verified log
+        // can still hold e.g. month 13: count it and move on
+        int64_t t = 0;
+        if (!parseTimestampSeconds(f.time, t) ||
+            (f.action != "enter" && f.action != "exit")) {
+            out.skipped++;
+            continue;
+        }
+        out.time.push_back(t);
+        out.actor.push_back(intern(actorIds, out.actorNames, f.actor));
+        out.room.push_back(intern(roomIds, out.roomNames, f.room));
+        out.delta.push_back(f.action == "enter" ? 1 : -1);
+    }
+
+    // log order is append order; timestamps are supplied by the caller
+    // and need not be monotonic
+    if (!std::is_sorted(out.time.begin(), out.time.end())) {
+        std::vector<size_t> order(out.time.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return out.time[a] < out.time[b]; });
+        permute(out.time, order);
+        permute(out.actor, order);
+        permute(out.room, order);
+        permute(out.delta, order);
+    }
+
+    // drop events that do not change anyone's presence, replayed in
+    // time order (unlike --present, which replays in log order)
+    // (a dense actor x room bitmap when that is small, else a hash set)
+    const size_t R = out.roomNames.size();
+    if (out.actorNames.size() * R <= MAX_PRESENCE_BITS) {
+        std::vector<bool> inside(out.actorNames.size() * R, false);
+        for (size_t i = 0; i < out.delta.size(); ++i) {
+            std::vector<bool>::reference in = inside[out.actor[i] * R + out.room[i]];
+            bool entering = out.delta[i] > 0;
+            if (in == entering) out.delta[i] = 0;
+            in = entering;
+        }
+        return;
+    }
+    std::unordered_set<uint64_t> inside;
+    for (size_t i = 0; i < out.delta.size(); ++i) {
+        uint64_t k = visitKey(out.actor[i], out.room[i]);
+        bool changed = (out.delta[i] > 0) ? inside.insert(k).second
+                                          : inside.erase(k) > 0;
+        if (!changed) out.delta[i] = 0;
+    }
+}
+
+// --------------------------
+// occupancy kernel
+// --------------------------
+// run f(0..n-1) on n threads (inline when n == 1)
+template <typename F>
+static void parallelFor(unsigned n, F f) {
+    if (n <= 1) {
+        f(0u);
+        return;
+    }
+    std::vector<std::thread> pool;
+    pool.reserve(n);
+    for (unsigned k = 0; k < n; ++k) pool.emplace_back(f, k);
+    for (std::thread &t : pool) t.join();
+}
+
+bool computeOccupancy(const EventColumns &ev, int64_t width,
+                      unsigned threads, OccupancyHistogram &out) {
+    out = OccupancyHistogram();
+    out.width = width;
+    out.rooms = ev.roomNames.size();
+    const size_t n = ev.time.size();
+    if (n == 0 || width <= 0) return width > 0;
+
+    // align buckets to multiples of width (e.g. whole hours)
+    int64_t first = ev.time.front();
+    out.origin  = first - ((first % width) + width) % width;
+    out.buckets = (size_t)((ev.time.back() - out.origin) / width) + 1;
+    if (out.buckets > MAX_HISTOGRAM_CELLS / std::max<size_t>(out.rooms, 1)) {
+        return false;
+    }
+
+    const size_t R = out.rooms;
+    out.peak.assign(out.buckets * R, 0);
+    out.occupancyEnd.assign(out.buckets * R, 0);
+    out.entries.assign(out.buckets * R, 0);
+    out.exits.assign(out.buckets * R, 0);
+
+    unsigned T = (unsigned)std::min<size_t>(std::max(threads, 1u), out.buckets);
+    T = (unsigned)std::min<size_t>(T, n);
+
+    // bucket index column (straight-line loop, vectorises)
+    std::vector<uint32_t> bucket(n);
+    parallelFor(T, [&](unsigned k) {
+        size_t lo = n * k / T, hi = n * (k + 1) / T;
+        const int64_t *t = ev.time.data();
+        for (size_t i = lo; i < hi; ++i) {
+            bucket[i] = (uint32_t)((t[i] - out.origin) / width);
+        }
+    });
+
+    // each thread owns a contiguous range of buckets and the events in it
+    std::vector<size_t> bucketLo(T + 1), eventLo(T + 1);
+    for (unsigned k = 0; k <= T; ++k) {
+        bucketLo[k] = out.buckets * k / T;
+        eventLo[k]  = (size_t)(std::lower_bound(bucket.begin(), bucket.end(),
+                                                (uint32_t)bucketLo[k]) - bucket.begin());
+    }
+
+    // pass 1: net headcount change per room within each range
+    std::vector<int32_t> start((T + 1) * R, 0);
+    parallelFor(T, [&](unsigned k) {
+        int32_t *net = &start[(k + 1) * R];
+        for (size_t i = eventLo[k]; i < eventLo[k + 1]; ++i) {
+            net[ev.room[i]] += ev.delta[i];
+        }
+    });
+    // exclusive scan: headcount at the start of each range
+    for (unsigned k = 1; k <= T; ++k) {
+        for (size_t r = 0; r < R; ++r) start[k * R + r] += start[(k - 1) * R + r];
+    }
+
+    // pass 2: running headcount and per-bucket aggregates
+    parallelFor(T, [&](unsigned k) {
+        std::vector<int32_t> occ(start.begin() + k * R, start.begin() + (k + 1) * R);
+        size_t i = eventLo[k];
+        for (size_t b = bucketLo[k]; b < bucketLo[k + 1]; ++b) {
+            int32_t  *pk  = &out.peak[b * R];
+            uint32_t *ent = &out.entries[b * R];
+            uint32_t *ext = &out.exits[b * R];
+            // people already inside count towards this bucket's peak
+            std::copy(occ.begin(), occ.end(), pk);
+            for (; i < eventLo[k + 1] && bucket[i] == b; ++i) {
+                uint32_t r = ev.room[i];
+                int32_t  d = ev.delta[i];
+                occ[r] += d;
+                pk[r]   = std::max(pk[r], occ[r]);
+                ent[r] += (d > 0);
+                ext[r] += (d < 0);
+            }
+            std::copy(occ.begin(), occ.end(), &out.occupancyEnd[b * R]);
+        }
+    });
+    return true;
+}
+
+// --------------------------
+// dwell kernel
+// pairs each enter with the matching exit of the same actor/room
+// --------------------------
+DwellHistogram computeDwell(const EventColumns &ev, int64_t width) {
+    DwellHistogram h;
+    h.width = width;
+    h.bins  = DWELL_BINS;
+    h.rooms = ev.roomNames.size();
+    h.counts.assign(h.bins * h.rooms, 0);
+    if (width <= 0) return h;
+
+    std::unordered_map<uint64_t, int64_t> enteredAt;
+    for (size_t i = 0; i < ev.time.size(); ++i) {
+        if (ev.delta[i] == 0) continue;
+        uint64_t k = visitKey(ev.actor[i], ev.room[i]);
+        if (ev.delta[i] > 0) {
+            enteredAt[k] = ev.time[i];
+            continue;
+        }
+        auto it = enteredAt.find(k);
+        if (it == enteredAt.end()) continue;
+        size_t bin = std::min<int64_t>((ev.time[i] - it->second) / width,
+                                       (int64_t)h.bins - 1);
+        h.counts[ev.room[i] * h.bins + bin]++;
+        enteredAt.erase(it);
+    }
+    return h;
+}
+
+// --------------------------
+// output (CSV or one JSON array)
+// --------------------------
+void writeOccupancy(std::ostream &os, const OccupancyHistogram &h,
+                    const EventColumns &ev, bool json,
+                    const std::string &roomFilter) {
+    if (json) os << "[";
+    else      os << "bucket_start,room,peak,entries,exits,occupancy_end\n";
+
+    bool firstRow = true;
+    for (size_t b = 0; b < h.buckets; ++b) {
+        std::string when = formatTimestampSeconds(h.origin + (int64_t)b * h.width);
+        for (size_t r = 0; r < h.rooms; ++r) {
+            size_t c = b * h.rooms + r;
+            // skip rooms that are empty and quiet in this bucket
+            if (h.peak[c] == 0 && h.entries[c] == 0 && h.exits[c] == 0) continue;
+            if (!roomFilter.empty() && ev.roomNames[r] != roomFilter) continue;
+
+            if (json) {
+                os << (firstRow ? "\n" : ",\n")
+                   << "{\"bucket_start\":\"" << when << "\","
+                   << "\"room\":\""          << ev.roomNames[r] << "\","
+                   << "\"peak\":"            << h.peak[c] << ","
+                   << "\"entries\":"         << h.entries[c] << ","
+                   << "\"exits\":"           << h.exits[c] << ","
+                   << "\"occupancy_end\":"   << h.occupancyEnd[c] << "}";
+            } else {
+                os << when << "," << ev.roomNames[r] << ","
+                   << h.peak[c] << "," << h.entries[c] << ","
+                   << h.exits[c] << "," << h.occupancyEnd[c] << "\n";
+            }
+            firstRow = false;
+        }
+    }
+    if (json) os << "\n]\n";
+}
+
+void writeDwell(std::ostream &os, const DwellHistogram &h,
+                const EventColumns &ev, bool json,
+                const std::string &roomFilter) {
+    // dwell_from_seconds is the lower edge of the bin; the last bin is open-ended
+    if (json) os << "[";
+    else      os << "room,dwell_from_seconds,visits\n";
+
+    bool firstRow = true;
+    for (size_t r = 0; r < h.rooms; ++r) {
+        if (!roomFilter.empty() && ev.roomNames[r] != roomFilter) continue;
+        for (size_t k = 0; k < h.bins; ++k) {
+            uint64_t visits = h.counts[r * h.bins + k];
+            if (visits == 0) continue;
+            int64_t from = (int64_t)k * h.width;
+
+            if (json) {
+                os << (firstRow ? "\n" : ",\n")
+                   << "{\"room\":\""              << ev.roomNames[r] << "\","
+                   << "\"dwell_from_seconds\":"   << from << ","
+                   << "\"visits\":"               << visits << "}";
+            } else {
+                os << ev.roomNames[r] << "," << from << "," << visits << "\n";
+            }
+            firstRow = false;
+        }
+    }
+    if (json) os << "\n]\n";
+}
+
+HistogramResult runHistogramFromArgs(int argc, char* argv[],
+                                     const std::vector<std::string> &lines) {
+    // Example usage:
+    //   ./logread --histogram --bucket 1h --format csv
+    //   ./logread --histogram --dwell --bucket 15m --room GalleryA
+    std::string bucketSpec = argExists("--bucket", argc, argv)
+                           ? getArgValue("--bucket", argc, argv) : "1h";
+    std::string format     = argExists("--format", argc, argv)
+                           ? getArgValue("--format", argc, argv) : "csv";
+    std::string roomFilter = getArgValue("--room", argc, argv);
+
+    int64_t width = parseBucketSpec(bucketSpec);
+    if (width <= 0 || (format != "csv" && format != "json") ||
+        (!roomFilter.empty() && !isValidName(roomFilter, 64))) {
+        return HistogramResult::BadInput;
+    }
+    bool json = (format == "json");
+
+    EventColumns ev;
+    decodeEvents(lines, ev);
+    if (ev.skipped > 0) {
+        std::cerr << "Skipped " << ev.skipped
+                  << " entries with unusable timestamps.\n";
+    }
+
+    if (argExists("--dwell", argc, argv)) {
+        writeDwell(std::cout, computeDwell(ev, width), ev, json, roomFilter);
+        return HistogramResult::Ok;
+    }
+
+    OccupancyHistogram h;
+    if (!computeOccupancy(ev, width, std::thread::hardware_concurrency(), h)) {
+        return HistogramResult::TooLarge;
+    }
+    writeOccupancy(std::cout, h, ev, json, roomFilter);
+    return HistogramResult::Ok;
+}
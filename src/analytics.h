@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+// ---- columnar event decoding ----
+// One slot per enter/exit event, sorted by time. Actor and room names
+// are interned so the kernels below only touch small integer columns.
+struct EventColumns {
+    std::vector<int64_t>  time;   // seconds since 1970-01-01T00:00:00Z
+    std::vector<uint32_t> actor;  // index into actorNames
+    std::vector<uint32_t> room;   // index into roomNames
+    std::vector<int8_t>   delta;  // +1 enter, -1 exit, 0 no state change
+    std::vector<std::string> actorNames;
+    std::vector<std::string> roomNames;
+    size_t skipped = 0;           // entries with an unusable time/action
+};
+
+// "YYYY-MM-DDTHH:MM:SSZ" <-> seconds since the epoch (UTC)
+bool parseTimestampSeconds(std::string_view ts, int64_t &out);
+std::string formatTimestampSeconds(int64_t t);
+
+// "30s", "15m", "1h", "1d" -> seconds; 0 if invalid
+int64_t parseBucketSpec(const std::string &spec);
+
+// Decode verified log lines (rotation records are skipped). Entries whose
+// timestamp is not a real date are skipped and counted in `skipped`.
+// Events are then sorted by timestamp and replayed in that order: a
+// repeated enter or an exit without a matching enter gets delta 0.
+// (--present replays in log order, so the two can disagree when
+// timestamps were appended out of order.)
+void decodeEvents(const std::vector<std::string> &lines, EventColumns &out);
+
+// ---- occupancy histogram ----
+// Dense [bucket][room] tables (index bucket * rooms + room).
+// Bucket b covers [origin + b*width, origin + (b+1)*width).
+struct OccupancyHistogram {
+    int64_t origin = 0;
+    int64_t width  = 0;
+    size_t buckets = 0;
+    size_t rooms   = 0;
+    std::vector<int32_t>  peak;          // max headcount during the bucket
+    std::vector<int32_t>  occupancyEnd;  // headcount when the bucket closes
+    std::vector<uint32_t> entries;
+    std::vector<uint32_t> exits;
+};
+
+// Buckets are split into contiguous time ranges, one per thread.
+// Returns false if the tables would be unreasonably large.
+bool computeOccupancy(const EventColumns &ev, int64_t width,
+                      unsigned threads, OccupancyHistogram &out);
+
+// ---- dwell time distribution ----
+// counts[room * bins + k] = visits lasting [k*width, (k+1)*width);
+// the last bin also takes every longer visit.
+struct DwellHistogram {
+    int64_t width = 0;
+    size_t bins   = 0;
+    size_t rooms  = 0;
+    std::vector<uint64_t> counts;
+};
+DwellHistogram computeDwell(const EventColumns &ev, int64_t width);
+
+// ---- output ----
+void writeOccupancy(std::ostream &os, const OccupancyHistogram &h,
+                    const EventColumns &ev, bool json,
+                    const std::string &roomFilter);
+void writeDwell(std::ostream &os, const DwellHistogram &h,
+                const EventColumns &ev, bool json,
+                const std::string &roomFilter);
+
+// logread --histogram [--bucket 1h] [--dwell] [--format csv|json] [--room R]
+// Ok:       histogram written to stdout
+// BadInput: unusable arguments
+// TooLarge: bucket too narrow for the log's time span
+enum class HistogramResult { Ok, BadInput, TooLarge };
+HistogramResult runHistogramFromArgs(int argc, char* argv[],
+                                     const std::vector<std::string> &lines);
@@ -5,6 +5,8 @@
 
 #include "hmac.h"
 #include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
 #include <stdexcept>
 
 // convert raw bytes -> lowercase hex string
@@ -36,4 +38,50 @@ std::string computeHMAC_SHA256(const std::string &key,
     }
 
     return toHex(buff, len); // we store/compare hex
-}
\ No newline at end of file
+}
+
+HmacContext::HmacContext(const std::string &key) : ctx_(nullptr) {
+    EVP_MAC *mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+    if (!mac) {
+        throw std::runtime_error("HMAC failed");
+    }
+    ctx_ = EVP_MAC_CTX_new(mac);
+    EVP_MAC_free(mac); // ctx keeps its own reference
+
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()
+    };
+    if (!ctx_ ||
+        !EVP_MAC_init(ctx_,
+                      reinterpret_cast<const unsigned char*>(key.data()),
+                      key.size(), params)) {
+        EVP_MAC_CTX_free(ctx_);
+        throw std::runtime_error("HMAC failed");
+    }
+}
+
+HmacContext::~HmacContext() {
+    EVP_MAC_CTX_free(ctx_);
+}
+
+std::string HmacContext::compute(const std::string &data) const {
+    // work on a copy so the keyed base context stays reusable
+    EVP_MAC_CTX *c = EVP_MAC_CTX_dup(ctx_);
+    size_t len = 0;
+    unsigned char buff[EVP_MAX_MD_SIZE];
+
+    bool ok = c &&
+              EVP_MAC_update(c,
+                             reinterpret_cast<const unsigned char*>(data.data()),
+                             data.size()) &&
+              EVP_MAC_final(c, buff, &len, sizeof(buff));
+    EVP_MAC_CTX_free(c);
+
+    if (!ok) {
+        throw std::runtime_error("HMAC failed");
+    }
+
+    return toHex(buff, (unsigned int)len);
+}
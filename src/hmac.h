@@ -4,4 +4,22 @@
 // Compute HMAC-SHA256(key, data) and return it as a hex string.
 // We use this for tamper-evident log entries.
 std::string computeHMAC_SHA256(const std::string &key,
-                               const std::string &data);
\ No newline at end of file
+                               const std::string &data);
+
+// HMAC-SHA256 with the key schedule done once up front.
+// The verifier keeps one of these per key epoch so that checking
+// millions of entries does not redo the key setup for every line.
+struct evp_mac_ctx_st;
+class HmacContext {
+public:
+    explicit HmacContext(const std::string &key);
+    ~HmacContext();
+    HmacContext(const HmacContext &) = delete;
+    HmacContext &operator=(const HmacContext &) = delete;
+
+    // same output as computeHMAC_SHA256(key, data)
+    std::string compute(const std::string &data) const;
+
+private:
+    evp_mac_ctx_st *ctx_;
+};
@@ -7,6 +7,8 @@
 // - validated input
 // - chained HMAC for tamper protection
 // - atomic append with locking
+// - torn-tail recovery after a crash
+// - integrity key rotation (--rotate-key) without re-MACing history
 // - audit logging
 
 #include <iostream>
@@ -17,6 +19,7 @@
 
 static const size_t MAX_NAME_LEN = 64;
 static const size_t MAX_ROOM_LEN = 64;
+static const size_t MAX_KEY_ID_LEN = 64;
 
 int main(int argc, char* argv[]) {
     try {
@@ -50,44 +53,95 @@ int main(int argc, char* argv[]) {
         }
 
         // 3) parse CLI args
+        //    (--rotate-key <id> appends a key epoch record instead of an event)
+        bool rotating         = argExists("--rotate-key", argc, argv);
+        std::string newKeyId  = getArgValue("--rotate-key", argc, argv);
         std::string actor     = getArgValue("--actor",  argc, argv);
         std::string action    = getArgValue("--action", argc, argv);
         std::string room      = getArgValue("--room",   argc, argv);
         std::string timestamp = getArgValue("--time",   argc, argv);
 
         // 4) validate inputs (bounds, allowed chars)
-        if (!isValidName(actor, MAX_NAME_LEN) ||
-            !isValidAction(action)            ||
-            !isValidName(room, MAX_ROOM_LEN)  ||
-            !isValidTimestamp(timestamp)) {
-
+        bool inputOk = rotating
+            ? isValidName(newKeyId, MAX_KEY_ID_LEN)
+            : (isValidName(actor, MAX_NAME_LEN) &&
+               isValidAction(action)            &&
+               isValidName(room, MAX_ROOM_LEN)  &&
+               isValidTimestamp(timestamp));
+        if (!inputOk) {
             auditSecurityEvent("logappend", "INVALID_INPUT");
             std::cerr << "Bad input.\n";
             return 1;
         }
 
-        // 5) create chained log entry with prev hash + hmac
-        std::string prevHash = getPreviousHash("gallery.log");
-        std::string partial  = formatLogEntry(actor, action, room, timestamp, prevHash);
-
-        std::string integrityKey = loadIntegrityKey();
-        if (integrityKey.empty()) {
+        IntegrityKeyring keyring = loadIntegrityKeyring();
+        if (keyring.empty()) {
             std::cerr << "Integrity key not set.\n";
             return 1;
         }
 
-        std::string hmacVal = computeHMAC_SHA256(integrityKey, partial);
+        // 5) recover from a crash mid-append (torn last line) before
+        //    chaining onto the tail; only the tail is inspected
+        TailRecovery recovery = recoverTornTail("gallery.log", keyring);
+        if (recovery == TailRecovery::Failed) {
+            auditSecurityEvent("logappend", "RECOVERY_FAIL");
+            std::cerr << "Log tail damaged; refusing to append.\n";
+            return 1;
+        }
+        if (recovery == TailRecovery::Repaired) {
+            auditSecurityEvent("logappend", "TORN_TAIL_QUARANTINED");
+        }
+
+        // the keyring must hold the keys the log actually committed to,
+        // otherwise we would append an entry no reader can ever verify
+        if (!verifyTailKey("gallery.log", keyring)) {
+            auditSecurityEvent("logappend", "KEY_MISMATCH");
+            std::cerr << "Integrity key does not match log.\n";
+            return 1;
+        }
+
+        // the key epoch in force is read from the tail, like prevHash
+        std::string epoch = getCurrentKeyEpoch("gallery.log");
+        auto currentKey = keyring.find(epoch);
+        if (currentKey == keyring.end()) {
+            std::cerr << "Integrity key for current epoch not set.\n";
+            return 1;
+        }
+
+        // 6) create chained log entry with prev hash + hmac
+        std::string prevHash = getPreviousHash("gallery.log");
+        std::string partial;
+        if (rotating) {
+            auto newKey = keyring.find(newKeyId);
+            // epoch "0" is the original INTEGRITY_KEY: never rotate back to it
+            if (newKey == keyring.end() || newKeyId == epoch || newKeyId == "0") {
+                auditSecurityEvent("logappend", "INVALID_INPUT");
+                std::cerr << "Bad input.\n";
+                return 1;
+            }
+            partial = formatRotationEntry(newKeyId,
+                                          computeKeyFingerprint(newKeyId, newKey->second),
+                                          prevHash, epoch);
+        } else {
+            partial = formatLogEntry(actor, action, room, timestamp, prevHash, epoch);
+        }
+
+        std::string hmacVal = computeHMAC_SHA256(currentKey->second, partial);
 
         // finalize the line with hmac and newline
         std::string finalLine = partial + ",\"hmac\":\"" + hmacVal + "\"}\n";
 
-        // 6) append securely
+        // 7) append securely
         if (!appendSecure("gallery.log", finalLine)) {
             auditSecurityEvent("logappend", "WRITE_FAIL");
             std::cerr << "Write failed.\n";
             return 1;
         }
 
+        if (rotating) {
+            auditSecurityEvent("logappend", "KEY_ROTATED");
+        }
+
         return 0;
     } catch (...) {
         auditSecurityEvent("logappend", "EXCEPTION");
@@ -5,12 +5,14 @@
 // - read token auth
 // - integrity verification of log
 // - safe output (no secrets)
+// - occupancy histograms over time buckets
 
 #include <iostream>
 #include <vector>
 #include <string>
 #include "security_utils.h"
 #include "hmac.h"
+#include "analytics.h"
 
 int main(int argc, char* argv[]) {
     try {
@@ -29,20 +31,29 @@ int main(int argc, char* argv[]) {
         }
 
         // 2) read log
-        std::vector<std::string> lines = readAllLines("gallery.log");
+        //    (a crash mid-append can leave a torn last line; it is set
+        //     aside here and quarantined by the next logappend)
+        std::string tornTail;
+        std::vector<std::string> lines = readAllLines("gallery.log", tornTail);
 
         // 3) verify integrity
-        std::string integrityKey = loadIntegrityKey();
-        if (integrityKey.empty()) {
+        //    (each key epoch is checked with its own key from the keyring)
+        IntegrityKeyring keyring = loadIntegrityKeyring();
+        if (keyring.empty()) {
             std::cerr << "Integrity key not set.\n";
             return 1;
         }
 
-        bool ok = verifyLogIntegrity(lines, integrityKey);
+        bool ok = verifyLogIntegrity(lines, keyring);
         if (!ok) {
             std::cerr << "Log integrity FAILED.\n";
             return 1;
         }
+        if (!tornTail.empty()) {
+            auditSecurityEvent("logread", "TORN_TAIL_PENDING");
+            std::cerr << "Torn last entry ignored (crash during append); "
+                         "next logappend will quarantine it.\n";
+        }
 
         // 4) special flag to just check integrity
         if (argExists("--verify-integrity", argc, argv)) {
@@ -50,7 +61,22 @@ int main(int argc, char* argv[]) {
             return 0;
         }
 
-        // 5) otherwise handle query (like --room X --present)
+        // 5) occupancy analytics (--histogram --bucket 1h ...)
+        if (argExists("--histogram", argc, argv)) {
+            HistogramResult r = runHistogramFromArgs(argc, argv, lines);
+            if (r == HistogramResult::BadInput) {
+                auditSecurityEvent("logread", "INVALID_INPUT");
+                std::cerr << "Bad input.\n";
+                return 1;
+            }
+            if (r == HistogramResult::TooLarge) {
+                std::cerr << "Histogram too large; use a wider --bucket.\n";
+                return 1;
+            }
+            return 0;
+        }
+
+        // 6) otherwise handle query (like --room X --present)
         runQueryFromArgs(argc, argv, lines);
 
         return 0;
@@ -13,12 +13,14 @@
 #include <regex>
 #include <stdexcept>
 #include <vector>
+#include <map>
+#include <memory>
 #include <cstring>
 #include <ctime>
 #include <sys/file.h>   // flock()
-#include <sys/stat.h>   // chmod
+#include <sys/stat.h>   // chmod, fstat()
 #include <fcntl.h>      // open()
-#include <unistd.h>     // write(), fsync(), close()
+#include <unistd.h>     // write(), pread(), fsync(), ftruncate(), close()
 #include <cstdlib>      // getenv
 
 // --------------------------
@@ -63,6 +65,32 @@ std::string loadIntegrityKey() {
     if (!v) return "";
     return std::string(v);
 }
+IntegrityKeyring loadIntegrityKeyring() {
+    IntegrityKeyring ring;
+    std::string genesis = loadIntegrityKey();
+    if (!genesis.empty()) ring["0"] = genesis;
+
+    const char* v = std::getenv("INTEGRITY_KEYRING");
+    if (!v) return ring;
+
+    // "id:key,id:key" -- a malformed keyring is a config error,
+    // so return nothing rather than a partial ring
+    std::stringstream ss{std::string(v)};
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::size_t colon = item.find(':');
+        if (colon == std::string::npos) return IntegrityKeyring();
+        std::string id  = item.substr(0, colon);
+        std::string key = item.substr(colon + 1);
+        // epoch "0" is reserved for INTEGRITY_KEY, and an id may only
+        // name one key
+        if (!isValidName(id, 64) || key.empty() || id == "0" ||
+            !ring.emplace(id, key).second) {
+            return IntegrityKeyring();
+        }
+    }
+    return ring;
+}
 
 // --------------------------
 // audit log: append security-relevant events
@@ -153,26 +181,137 @@ static std::string extractHashFromLine(const std::string &line) {
     return line.substr(pos, end-pos);
 }
 
-std::string getPreviousHash(const std::string &logPath) {
-    std::ifstream in(logPath);
-    if (!in.is_open()) {
-        // no file yet, so "genesis"
-        return "GENESIS";
+// --------------------------
+// tail scanning helpers
+// these read gallery.log backwards in small chunks so that
+// appends and crash recovery never have to walk the whole log
+// --------------------------
+static const size_t TAIL_CHUNK = 4096;
+
+// a single entry is well under 1 KiB, so an unterminated tail longer than
+// this cannot be one partially written line
+static const off_t MAX_TORN_FRAGMENT = (off_t)TAIL_CHUNK;
+
+// find the last '\n' strictly before `end`; nl is -1 if there is none.
+// returns false on a read error, which must not be mistaken for "none".
+static bool findNewlineBefore(int fd, off_t end, off_t &nl) {
+    char buf[TAIL_CHUNK];
+    nl = -1;
+    while (end > 0) {
+        off_t start = (end > (off_t)TAIL_CHUNK) ? end - (off_t)TAIL_CHUNK : 0;
+        ssize_t n = ::pread(fd, buf, (size_t)(end - start), start);
+        if (n != (ssize_t)(end - start)) return false;
+        for (ssize_t i = n - 1; i >= 0; --i) {
+            if (buf[i] == '\n') {
+                nl = start + i;
+                return true;
+            }
+        }
+        end = start;
     }
+    return true;
+}
+
+// find the last complete (newline-terminated, non-empty) line.
+// tornStart is set to the offset just past the last '\n', so any
+// bytes in [tornStart, size) are an unterminated (torn) fragment.
+// line is left empty if there is no complete line.
+// returns false on a read error.
+static bool readLastCompleteLine(int fd, off_t size,
+                                 std::string &line, off_t &tornStart) {
+    line.clear();
+    off_t nl = -1;
+    if (!findNewlineBefore(fd, size, nl)) return false;
+    tornStart = nl + 1;
+    while (nl >= 0) {
+        off_t prev = -1;
+        if (!findNewlineBefore(fd, nl, prev)) return false;
+        off_t start = prev + 1;
+        if (nl > start) {
+            line.resize((size_t)(nl - start));
+            ssize_t n = ::pread(fd, &line[0], line.size(), start);
+            return n == (ssize_t)line.size();
+        }
+        nl = prev; // skip blank line
+    }
+    return true;
+}
+
+// last complete line of the log ("" if none / no log yet)
+static std::string readLastLogLine(const std::string &logPath) {
+    int fd = ::open(logPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return "";
+    }
+    struct stat st;
     std::string lastLine;
-    std::string line;
-    while (std::getline(in, line)) {
-        if (!line.empty()) lastLine = line;
+    off_t tornStart = 0;
+    bool ok = fstat(fd, &st) == 0 &&
+              readLastCompleteLine(fd, st.st_size, lastLine, tornStart);
+    ::close(fd);
+
+    // chaining onto a guessed tail would break the log, so fail loudly
+    if (!ok) {
+        throw std::runtime_error("log tail read failed");
     }
-    in.close();
+    return lastLine;
+}
 
+std::string getPreviousHash(const std::string &logPath) {
+    std::string lastLine = readLastLogLine(logPath);
     if (lastLine.empty()) {
+        // no file yet, so "genesis"
         return "GENESIS";
     }
     // hmac of last line becomes prevHash for next line
     return extractHashFromLine(lastLine);
 }
 
+static bool verifyEntryMAC(const std::string &line,
+                           const HmacContext &mac);
+
+// epoch a line was MAC'd under (legacy lines carry no "epoch" field)
+static std::string entryEpoch(const std::string &line) {
+    std::string epoch = extractField(line, "epoch");
+    return epoch.empty() ? "0" : epoch;
+}
+
+// Does the keyring hold the right keys to continue after this line?
+// The line must carry a valid HMAC under its epoch's key, and if it is
+// a rotation record the keyring's key for the new epoch must match the
+// fingerprint the record committed to.
+static bool tailKeyOk(const std::string &lastLine,
+                      const IntegrityKeyring &keyring) {
+    if (lastLine.empty()) return true;
+
+    auto k = keyring.find(entryEpoch(lastLine));
+    if (k == keyring.end() || !verifyEntryMAC(lastLine, HmacContext(k->second))) {
+        return false;
+    }
+    std::string rotate = extractField(lastLine, "rotate");
+    if (rotate.empty()) return true;
+    if (rotate == "0") return false;
+
+    auto next = keyring.find(rotate);
+    return next != keyring.end() &&
+           constTimeEquals(extractField(lastLine, "keyfp"),
+                           computeKeyFingerprint(rotate, next->second));
+}
+
+bool verifyTailKey(const std::string &logPath,
+                   const IntegrityKeyring &keyring) {
+    return tailKeyOk(readLastLogLine(logPath), keyring);
+}
+
+std::string getCurrentKeyEpoch(const std::string &logPath) {
+    std::string lastLine = readLastLogLine(logPath);
+
+    // a rotation record switches every following entry to the new key
+    std::string rotated = extractField(lastLine, "rotate");
+    if (!rotated.empty()) return rotated;
+    return lastLine.empty() ? "0" : entryEpoch(lastLine);
+}
+
 // --------------------------
 // build the entry without "hmac", so we can MAC it
 // --------------------------
@@ -180,18 +319,54 @@ std::string formatLogEntry(const std::string &actor,
                            const std::string &action,
                            const std::string &room,
                            const std::string &timestamp,
-                           const std::string &prevHash) {
+                           const std::string &prevHash,
+                           const std::string &epoch) {
     std::ostringstream oss;
     oss << "{"
         << "\"actor\":\""     << actor     << "\","
         << "\"action\":\""    << action    << "\","
         << "\"room\":\""      << room      << "\","
-        << "\"time\":\""      << timestamp << "\","
-        << "\"prev\":\""      << prevHash  << "\"";
+        << "\"time\":\""      << timestamp << "\",";
+    // epoch "0" is left out so pre-rotation logs stay byte-identical
+    if (epoch != "0") {
+        oss << "\"epoch\":\"" << epoch     << "\",";
+    }
+    oss << "\"prev\":\""      << prevHash  << "\"";
     // NOTE: we intentionally do NOT write hmac yet.
     return oss.str();
 }
 
+// --------------------------
+// key rotation
+// Rotating is a single appended record, so history is never re-MAC'd:
+// {"rotate":"<new id>","keyfp":"<fp>","epoch":"<old id>","prev":...,"hmac":...}
+// The record is MAC'd with the OLD key (only its holder may rotate) and
+// the fingerprint proves which NEW key the following entries must use.
+// Epoch "0" (INTEGRITY_KEY) can never be rotated back to. Any other
+// retired id may be reused: the fingerprint still pins it to the exact
+// key, and verification stays O(1) per record. Use fresh ids if your
+// policy forbids reactivating an old key.
+// --------------------------
+std::string computeKeyFingerprint(const std::string &keyId,
+                                  const std::string &key) {
+    return computeHMAC_SHA256(key, "artlog-key-epoch:" + keyId);
+}
+
+std::string formatRotationEntry(const std::string &newKeyId,
+                                const std::string &keyFingerprint,
+                                const std::string &prevHash,
+                                const std::string &epoch) {
+    std::ostringstream oss;
+    oss << "{"
+        << "\"rotate\":\""    << newKeyId       << "\","
+        << "\"keyfp\":\""     << keyFingerprint << "\",";
+    if (epoch != "0") {
+        oss << "\"epoch\":\"" << epoch          << "\",";
+    }
+    oss << "\"prev\":\""      << prevHash       << "\"";
+    return oss.str();
+}
+
 // --------------------------
 // secure append with lock + fsync
 // --------------------------
@@ -226,14 +401,33 @@ bool appendSecure(const std::string &logPath,
 // read file fully into memory (used by logread)
 // --------------------------
 std::vector<std::string> readAllLines(const std::string &logPath) {
+    std::string tornTail;
+    std::vector<std::string> out = readAllLines(logPath, tornTail);
+    if (!tornTail.empty()) {
+        out.push_back(tornTail);
+    }
+    return out;
+}
+
+// same, but a short unterminated last line (what a crash mid-append
+// leaves behind) is returned in tornTail instead of in the lines.
+// Anything longer than one entry stays in the lines, so it still
+// fails verification like any other tampering.
+std::vector<std::string> readAllLines(const std::string &logPath,
+                                      std::string &tornTail) {
     std::vector<std::string> out;
+    tornTail.clear();
     std::ifstream in(logPath);
     if (!in.is_open()) {
         return out; // empty log is allowed
     }
     std::string line;
     while (std::getline(in, line)) {
-        if (!line.empty()) {
+        // getline() hits EOF only when the last line has no '\n'
+        if (in.eof() && !line.empty() &&
+            line.size() <= (size_t)MAX_TORN_FRAGMENT) {
+            tornTail = line;
+        } else if (!line.empty()) {
             out.push_back(line);
         }
     }
@@ -247,8 +441,8 @@ std::vector<std::string> readAllLines(const std::string &logPath) {
 // 2. recompute HMAC of the line-without-hmac and compare
 // 3. check "prev" links to previous line's hmac
 // --------------------------
-static std::string extractField(const std::string &line,
-                                const std::string &fieldName) {
+std::string extractField(const std::string &line,
+                         const std::string &fieldName) {
     // super light parser: finds "fieldName":"value"
     std::string needle = "\"" + fieldName + "\":\"";
     std::size_t pos = line.find(needle);
@@ -259,17 +453,62 @@ static std::string extractField(const std::string &line,
     return line.substr(pos, end-pos);
 }
 
+// recompute the HMAC of one entry and compare with its stored "hmac"
+static bool verifyEntryMAC(const std::string &line,
+                           const HmacContext &mac) {
+    std::string hmacStored = extractField(line, "hmac");
+    if (hmacStored.empty()) {
+        return false;
+    }
+
+    // reconstruct line-without-hmac the same way formatLogEntry() /
+    // formatRotationEntry() did, using the fields from the line
+    std::string prev      = extractField(line, "prev");
+    std::string epoch     = entryEpoch(line);
+    std::string rotate    = extractField(line, "rotate");
+
+    std::string reconstructed;
+    if (!rotate.empty()) {
+        reconstructed = formatRotationEntry(rotate, extractField(line, "keyfp"),
+                                            prev, epoch);
+    } else {
+        std::string actor     = extractField(line, "actor");
+        std::string action    = extractField(line, "action");
+        std::string room      = extractField(line, "room");
+        std::string time      = extractField(line, "time");
+        reconstructed = formatLogEntry(actor, action, room, time, prev, epoch);
+    }
+
+    // recompute HMAC
+    std::string hmacCheck = mac.compute(reconstructed);
+
+    return constTimeEquals(hmacStored, hmacCheck);
+}
+
 bool verifyLogIntegrity(const std::vector<std::string> &lines,
                         const std::string &key) {
+    IntegrityKeyring ring;
+    ring["0"] = key;
+    return verifyLogIntegrity(lines, ring);
+}
+
+bool verifyLogIntegrity(const std::vector<std::string> &lines,
+                        const IntegrityKeyring &keyring) {
+    // one keyed HMAC context per epoch, built the first time it is needed
+    std::map<std::string, std::unique_ptr<HmacContext>> contexts;
+    auto contextFor = [&](const std::string &epoch) -> const HmacContext * {
+        auto c = contexts.find(epoch);
+        if (c != contexts.end()) return c->second.get();
+        auto k = keyring.find(epoch);
+        if (k == keyring.end()) return nullptr;
+        return (contexts[epoch] = std::unique_ptr<HmacContext>(
+                    new HmacContext(k->second))).get();
+    };
+
     std::string prevHashExpected = "GENESIS";
+    std::string epochExpected = "0";
 
     for (const std::string &line : lines) {
-        // pull hmac
-        std::string hmacStored = extractField(line, "hmac");
-        if (hmacStored.empty()) {
-            return false;
-        }
-
         // pull prev
         std::string prevField = extractField(line, "prev");
         if (prevField.empty()) {
@@ -281,31 +520,106 @@ bool verifyLogIntegrity(const std::vector<std::string> &lines,
             return false;
         }
 
-        // reconstruct line-without-hmac the same way formatLogEntry() did
-        // We know formatLogEntry() ends before adding ,\"hmac\"...
-        // We'll rebuild that prefix here using the fields from the line:
-        std::string actor     = extractField(line, "actor");
-        std::string action    = extractField(line, "action");
-        std::string room      = extractField(line, "room");
-        std::string time      = extractField(line, "time");
-        std::string prev      = extractField(line, "prev");
-
-        std::string reconstructed = formatLogEntry(actor, action, room, time, prev);
-
-        // recompute HMAC
-        std::string hmacCheck = computeHMAC_SHA256(key, reconstructed);
-
-        if (!constTimeEquals(hmacStored, hmacCheck)) {
+        // every entry must be MAC'd under the epoch in force at its position
+        if (entryEpoch(line) != epochExpected) {
             return false;
         }
+        const HmacContext *mac = contextFor(epochExpected);
+        if (!mac || !verifyEntryMAC(line, *mac)) {
+            return false;
+        }
+
+        // rotation record: switch keys, after checking that the keyring's
+        // key for the new id is the one the record committed to
+        std::string rotate = extractField(line, "rotate");
+        if (!rotate.empty()) {
+            auto next = keyring.find(rotate);
+            if (rotate == epochExpected || rotate == "0" || next == keyring.end() ||
+                !constTimeEquals(extractField(line, "keyfp"),
+                                 computeKeyFingerprint(rotate, next->second))) {
+                return false;
+            }
+            epochExpected = rotate;
+        }
 
         // next line must reference this line's hmac
-        prevHashExpected = hmacStored;
+        prevHashExpected = extractField(line, "hmac");
     }
 
     return true;
 }
 
+// --------------------------
+// crash recovery: torn tail
+// appendSecure() writes one line per write(), so a crash can only
+// leave an unterminated fragment at the very end of the log.
+// We only look at the tail: the fragment after the last '\n' is
+// moved to <log>.quarantine and cut off, provided the last complete
+// line still carries a valid HMAC. Anything else is tampering, not
+// a crash, and is left for verifyLogIntegrity() to report.
+// --------------------------
+TailRecovery recoverTornTail(const std::string &logPath,
+                             const IntegrityKeyring &keyring) {
+    int fd = ::open(logPath.c_str(), O_RDWR);
+    if (fd < 0) {
+        // no log yet, nothing to recover
+        return TailRecovery::Clean;
+    }
+
+    // hold the same lock appendSecure() uses while we inspect/repair
+    if (flock(fd, LOCK_EX) != 0) {
+        ::close(fd);
+        return TailRecovery::Failed;
+    }
+
+    TailRecovery result = TailRecovery::Failed;
+    struct stat st;
+    std::string lastLine;
+    off_t tornStart = 0;
+
+    // any read error while scanning the tail means we do not know where
+    // the damage starts, so nothing is touched
+    if (fstat(fd, &st) == 0 &&
+        readLastCompleteLine(fd, st.st_size, lastLine, tornStart)) {
+        // (a clean tail is still key-checked by the caller via verifyTailKey())
+        if (tornStart >= st.st_size) {
+            result = TailRecovery::Clean;
+        } else if (!tailKeyOk(lastLine, keyring) ||
+                   st.st_size - tornStart > MAX_TORN_FRAGMENT) {
+            // last complete entry is bad too, or the "fragment" is far
+            // longer than any entry: not a torn write
+            result = TailRecovery::Failed;
+        } else {
+            std::string fragment((size_t)(st.st_size - tornStart), '\0');
+            ssize_t n = ::pread(fd, &fragment[0], fragment.size(), tornStart);
+
+            // quarantine first, truncate second: a crash in between
+            // can only duplicate the fragment, never lose it
+            int qfd = ::open((logPath + ".quarantine").c_str(),
+                             O_WRONLY | O_APPEND | O_CREAT,
+                             0600);
+            if (n == (ssize_t)fragment.size() && qfd >= 0) {
+                std::string rec = nowIso() + " offset=" +
+                                  std::to_string((long long)tornStart) +
+                                  " len=" + std::to_string(fragment.size()) +
+                                  "\n" + fragment + "\n";
+                bool saved = (::write(qfd, rec.c_str(), rec.size()) == (ssize_t)rec.size())
+                             && ::fsync(qfd) == 0;
+                if (saved && ::ftruncate(fd, tornStart) == 0 && ::fsync(fd) == 0) {
+                    result = TailRecovery::Repaired;
+                }
+            }
+            if (qfd >= 0) ::close(qfd);
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    ::close(fd);
+
+    // auditing is left to the calling tool
+    return result;
+}
+
 // --------------------------
 // basic query logic for demonstration
 // This is not full production logic —
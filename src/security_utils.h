@@ -1,12 +1,18 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <map>
 
 // ---- authentication / secrets ----
 bool constTimeEquals(const std::string &a, const std::string &b);
 std::string loadWriterToken();   // expected token for logappend
 std::string loadReaderToken();   // expected token for logread
-std::string loadIntegrityKey();  // HMAC key for log integrity
+std::string loadIntegrityKey();  // HMAC key for log integrity (epoch "0")
+
+// key epoch id -> HMAC key. Epoch "0" is INTEGRITY_KEY; later epochs
+// come from INTEGRITY_KEYRING="id:key,id:key" (keys must not contain ',').
+typedef std::map<std::string, std::string> IntegrityKeyring;
+IntegrityKeyring loadIntegrityKeyring();
 
 // ---- audit logging ----
 void auditSecurityEvent(const std::string &tool,
@@ -23,19 +29,51 @@ bool isValidTimestamp(const std::string &ts);  // very basic ISO-ish check
 
 // ---- log helpers ----
 std::string getPreviousHash(const std::string &logPath);
+std::string getCurrentKeyEpoch(const std::string &logPath); // "0" if never rotated
+// O(1) check before appending: the last entry verifies under its epoch's
+// key, and a trailing rotation record matches the keyring's new key
+bool verifyTailKey(const std::string &logPath,
+                   const IntegrityKeyring &keyring);
 std::string formatLogEntry(const std::string &actor,
                            const std::string &action,
                            const std::string &room,
                            const std::string &timestamp,
-                           const std::string &prevHash);
+                           const std::string &prevHash,
+                           const std::string &epoch = "0");
+
+// key rotation record: MAC'd under the current epoch's key and
+// committing to the next epoch's key id + fingerprint
+std::string computeKeyFingerprint(const std::string &keyId,
+                                  const std::string &key);
+std::string formatRotationEntry(const std::string &newKeyId,
+                                const std::string &keyFingerprint,
+                                const std::string &prevHash,
+                                const std::string &epoch);
 bool appendSecure(const std::string &logPath,
                   const std::string &line);
 
 std::vector<std::string> readAllLines(const std::string &logPath);
+// as above, but a short unterminated last line (torn by a crash, pending
+// recovery by logappend) is split off into tornTail
+std::vector<std::string> readAllLines(const std::string &logPath,
+                                      std::string &tornTail);
+// value of "fieldName":"value" in a log line, or "" if absent
+std::string extractField(const std::string &line,
+                         const std::string &fieldName);
 
 // ---- integrity check ----
 bool verifyLogIntegrity(const std::vector<std::string> &lines,
                         const std::string &key);
+bool verifyLogIntegrity(const std::vector<std::string> &lines,
+                        const IntegrityKeyring &keyring);
+
+// ---- crash recovery ----
+// Clean:    log ends on a complete line, nothing done
+// Repaired: torn fragment moved to <log>.quarantine and truncated
+// Failed:   tail could not be repaired safely (log left untouched)
+enum class TailRecovery { Clean, Repaired, Failed };
+TailRecovery recoverTornTail(const std::string &logPath,
+                             const IntegrityKeyring &keyring);
 
 // ---- query logic ----
 void runQueryFromArgs(int argc, char* argv[],
@@ -0,0 +1,118 @@
+// tests/histogram_bench.cpp
+// Benchmark for logread --histogram on a synthetic log
+// (a year of traffic, 200 rooms, 20000 actors).
+// 1) kernels only: events generated straight into columns
+// 2) end to end: real log lines -> decodeEvents() -> computeOccupancy()
+//    (HMAC verification is not included; it runs before either)
+//
+// Build: cd src && make histogram_bench
+// Run:   ./histogram_bench [events=100000000] [threads=all cores] [lines=5000000]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include "../src/analytics.h"
+#include "../src/security_utils.h"
+
+static double msSince(std::chrono::steady_clock::time_point t0) {
+   return std::chrono::duration<double, std::milli>(
+              std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char* argv[]) {
+   size_t events = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000000ULL;
+   unsigned threads = (argc > 2) ? (unsigned)std::atoi(argv[2])
+                                 : std::thread::hardware_concurrency();
+   if (threads == 0) threads = 1;
+   size_t lineCount = (argc > 3) ? std::strtoull(argv[3], nullptr, 10)
+                                 : std::min<size_t>(events, 5000000);
+
+   const uint32_t rooms = 200, actors = 20000;
+   const int64_t start = 1735689600;      // 2025-01-01T00:00:00Z
+   const int64_t span  = 365LL * 86400;
+
+   EventColumns ev;
+   ev.time.resize(events);
+   ev.actor.resize(events);
+   ev.room.resize(events);
+   ev.delta.resize(events);
+   for (uint32_t r = 0; r < rooms; ++r)  ev.roomNames.push_back("Room" + std::to_string(r));
+   for (uint32_t a = 0; a < actors; ++a) ev.actorNames.push_back("actor" + std::to_string(a));
+
+   // each actor alternates between entering a random room and leaving it
+   std::vector<int32_t> where(actors, -1);
+   uint64_t rng = 88172645463325252ULL;
+   auto next = [&]() { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; return rng; };
+
+   auto t0 = std::chrono::steady_clock::now();
+   for (size_t i = 0; i < events; ++i) {
+       uint32_t a = (uint32_t)(next() % actors);
+       ev.time[i]  = start + (int64_t)((__int128)i * span / (int64_t)events);
+       ev.actor[i] = a;
+       if (where[a] < 0) {
+           where[a]    = (int32_t)(next() % rooms);
+           ev.room[i]  = (uint32_t)where[a];
+           ev.delta[i] = 1;
+       } else {
+           ev.room[i]  = (uint32_t)where[a];
+           ev.delta[i] = -1;
+           where[a]    = -1;
+       }
+   }
+   std::cout << "generate: " << events << " events in " << msSince(t0) << " ms\n";
+
+   for (unsigned T : {1u, threads}) {
+       OccupancyHistogram h;
+       t0 = std::chrono::steady_clock::now();
+       bool ok = computeOccupancy(ev, 3600, T, h);
+       double ms = msSince(t0);
+
+       int64_t checksum = 0;
+       for (int32_t p : h.peak) checksum += p;
+       std::cout << "occupancy 1h, " << T << " thread(s): " << ms << " ms ("
+                 << (events / 1e6) / (ms / 1e3) << " M events/s), buckets="
+                 << h.buckets << " ok=" << ok << " checksum=" << checksum << "\n";
+       if (T == threads) break;
+   }
+
+   t0 = std::chrono::steady_clock::now();
+   DwellHistogram d = computeDwell(ev, 3600);
+   double ms = msSince(t0);
+   uint64_t visits = 0;
+   for (uint64_t c : d.counts) visits += c;
+   std::cout << "dwell 1h: " << ms << " ms, visits=" << visits << "\n";
+ 
+   // end to end on real log lines: the first lineCount events, rendered
+   // the way logappend writes them (hmac/prev values do not affect decode)
+   lineCount = std::min(lineCount, events);
+   const std::string fakeHash(64, 'a');
+   std::vector<std::string> lines;
+   lines.reserve(lineCount);
+   for (size_t i = 0; i < lineCount; ++i) {
+       lines.push_back(formatLogEntry(ev.actorNames[ev.actor[i]],
+                                      ev.delta[i] > 0 ? "enter" : "exit",
+                                      ev.roomNames[ev.room[i]],
+                                      formatTimestampSeconds(ev.time[i]),
+                                      fakeHash) +
+                       ",\"hmac\":\"" + fakeHash + "\"}");
+   }
+   ev = EventColumns(); // free the kernel-only columns
+ 
+   t0 = std::chrono::steady_clock::now();
+   EventColumns decoded;
+   decodeEvents(lines, decoded);
+   double decodeMs = msSince(t0);
+ 
+   OccupancyHistogram h;
+   t0 = std::chrono::steady_clock::now();
+   bool ok = computeOccupancy(decoded, 3600, threads, h);
+   double occMs = msSince(t0);
+ 
+   std::cout << "end to end, " << lineCount << " lines, " << threads << " thread(s): decode "
+             << decodeMs << " ms + occupancy " << occMs << " ms = "
+             << (lineCount / 1e6) / ((decodeMs + occMs) / 1e3) << " M lines/s"
+             << " ok=" << ok << " skipped=" << decoded.skipped << "\n";
+   return 0;
+}
@@ -8,8 +8,37 @@
  
 #include <cassert>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
 #include "../src/security_utils.h"
 #include "../src/hmac.h"
+#include "../src/analytics.h"
+ 
+// build a fully MAC'd, chained line the same way logappend does
+static std::string makeEntry(const std::string &logPath,
+                             const std::string &key,
+                             const std::string &actor,
+                             const std::string &action,
+                             const std::string &room,
+                             const std::string &time,
+                             const std::string &epoch = "0") {
+   std::string partial = formatLogEntry(actor, action, room, time,
+                                        getPreviousHash(logPath), epoch);
+   return partial + ",\"hmac\":\"" + computeHMAC_SHA256(key, partial) + "\"}\n";
+}
+ 
+static std::string readFile(const std::string &path) {
+   std::ifstream in(path, std::ios::binary);
+   return std::string((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+}
+ 
+static void writeFile(const std::string &path, const std::string &data) {
+   std::ofstream out(path, std::ios::binary | std::ios::trunc);
+   out << data;
+}
  
 int main() {
    std::cout << "=== PHASE 3 SECURITY TESTS ===\n";
@@ -51,6 +80,290 @@ int main() {
        std::string h1 = computeHMAC_SHA256("key", "data");
        std::string h2 = computeHMAC_SHA256("key", "data");
        assert(h1 == h2);
+       assert(HmacContext("key").compute("data") == h1);
+   }
+ 
+   // Crash injection: torn tail recovery
+   // Simulate a crash at every byte offset inside an append and check
+   // that recovery quarantines the fragment and appending resumes.
+   {
+       const std::string log = "crash_test.log";
+       const std::string quarantine = log + ".quarantine";
+       IntegrityKeyring ring;
+       ring["0"] = "crash-key";
+       const std::string key = ring["0"];
+       std::remove(log.c_str());
+       std::remove(quarantine.c_str());
+ 
+       assert(recoverTornTail(log, ring) == TailRecovery::Clean); // no log yet
+ 
+       assert(appendSecure(log, makeEntry(log, key, "guard1", "enter", "GalleryA", "2025-10-30T10:00:00Z")));
+       assert(appendSecure(log, makeEntry(log, key, "guard2", "enter", "GalleryB", "2025-10-30T10:05:00Z")));
+       const std::string base = readFile(log);
+       const std::string next = makeEntry(log, key, "guard1", "exit", "GalleryA", "2025-10-30T10:10:00Z");
+ 
+       assert(recoverTornTail(log, ring) == TailRecovery::Clean);
+ 
+       for (size_t cut = 1; cut < next.size(); ++cut) {
+           writeFile(log, base + next.substr(0, cut));
+           // before recovery, readers set the fragment aside
+           std::string tornTail;
+           assert(verifyLogIntegrity(readAllLines(log, tornTail), ring));
+           assert(tornTail == next.substr(0, cut));
+           assert(recoverTornTail(log, ring) == TailRecovery::Repaired);
+           assert(readFile(log) == base);
+           assert(verifyLogIntegrity(readAllLines(log), key));
+       }
+       assert(readFile(quarantine).find(next.substr(0, next.size() - 1)) != std::string::npos);
+ 
+       // appending resumes on the repaired chain
+       writeFile(log, base + next.substr(0, 17));
+       assert(recoverTornTail(log, ring) == TailRecovery::Repaired);
+       assert(appendSecure(log, makeEntry(log, key, "guard1", "exit", "GalleryA", "2025-10-30T10:10:00Z")));
+       assert(verifyLogIntegrity(readAllLines(log), key));
+ 
+       // a bad last complete line is tampering, not a crash: leave it alone
+       std::string tampered = base;
+       tampered[tampered.find("GalleryB")] = 'X';
+       writeFile(log, tampered + "{\"actor\":\"gu");
+       assert(recoverTornTail(log, ring) == TailRecovery::Failed);
+       assert(readFile(log) == tampered + "{\"actor\":\"gu");
+ 
+       // unterminated data longer than any entry is not a torn append
+       const std::string junk(10000, 'x');
+       writeFile(log, junk);
+       assert(recoverTornTail(log, ring) == TailRecovery::Failed);
+       std::string tornTail;
+       assert(readAllLines(log, tornTail).size() == 1 && tornTail.empty());
+       assert(readFile(log) == junk);
+       writeFile(log, base + junk);
+       assert(recoverTornTail(log, ring) == TailRecovery::Failed);
+       assert(readFile(log) == base + junk);
+ 
+       std::remove(log.c_str());
+       std::remove(quarantine.c_str());
+   }
+ 
+   // Key rotation: epochs are verified with their own keys, history untouched
+   {
+       const std::string log = "rotate_test.log";
+       std::remove(log.c_str());
+       IntegrityKeyring ring;
+       ring["0"]  = "old-key";
+       ring["q2"] = "new-key";
+ 
+       assert(appendSecure(log, makeEntry(log, ring["0"], "guard1", "enter", "GalleryA", "2025-10-30T10:00:00Z")));
+       const std::string before = readFile(log);
+       assert(getCurrentKeyEpoch(log) == "0");
+ 
+       std::string rot = formatRotationEntry("q2", computeKeyFingerprint("q2", ring["q2"]),
+                                             getPreviousHash(log), "0");
+       assert(appendSecure(log, rot + ",\"hmac\":\"" + computeHMAC_SHA256(ring["0"], rot) + "\"}\n"));
+       assert(readFile(log).compare(0, before.size(), before) == 0); // O(1) append
+       assert(getCurrentKeyEpoch(log) == "q2");
+ 
+       const std::string rotated = readFile(log);
+       assert(appendSecure(log, makeEntry(log, ring["q2"], "guard1", "exit", "GalleryA", "2025-10-30T10:10:00Z", "q2")));
+       assert(verifyLogIntegrity(readAllLines(log), ring));
+       assert(getCurrentKeyEpoch(log) == "q2");
+ 
+       // old key alone cannot verify the new epoch
+       assert(verifyLogIntegrity(readAllLines(log), ring["0"]) == false);
+ 
+       // keyring holding a different key than the one committed to
+       IntegrityKeyring wrong = ring;
+       wrong["q2"] = "other-key";
+       assert(verifyLogIntegrity(readAllLines(log), wrong) == false);
+ 
+       // entry after rotation still MAC'd under the retired key
+       writeFile(log, rotated);
+       assert(appendSecure(log, makeEntry(log, ring["0"], "guard1", "exit", "GalleryA", "2025-10-30T10:10:00Z")));
+       assert(verifyLogIntegrity(readAllLines(log), ring) == false);
+ 
+       // appending refuses a keyring whose new-epoch key is wrong,
+       // both right after the rotation record and after a q2 entry
+       writeFile(log, rotated);
+       assert(verifyTailKey(log, ring));
+       assert(verifyTailKey(log, wrong) == false);
+       assert(appendSecure(log, makeEntry(log, ring["q2"], "guard1", "exit", "GalleryA", "2025-10-30T10:10:00Z", "q2")));
+       const std::string afterQ2 = readFile(log);
+       assert(verifyTailKey(log, ring));
+       assert(verifyTailKey(log, wrong) == false);
+ 
+       // torn tail recovery checks the last line with its epoch's key (q2)
+       writeFile(log, afterQ2 + "{\"actor\":\"gu");
+       assert(recoverTornTail(log, wrong) == TailRecovery::Failed);
+       assert(readFile(log) == afterQ2 + "{\"actor\":\"gu");
+       assert(recoverTornTail(log, ring) == TailRecovery::Repaired);
+       assert(readFile(log) == afterQ2);
+ 
+       // rotating back to the original key (epoch "0") is never valid
+       writeFile(log, afterQ2);
+       std::string back = formatRotationEntry("0", computeKeyFingerprint("0", ring["0"]),
+                                              getPreviousHash(log), "q2");
+       assert(appendSecure(log, back + ",\"hmac\":\"" + computeHMAC_SHA256(ring["q2"], back) + "\"}\n"));
+       assert(verifyLogIntegrity(readAllLines(log), ring) == false);
+       assert(verifyTailKey(log, ring) == false);
+ 
+       // keyring env parsing: epoch "0" and duplicate ids are malformed
+       setenv("INTEGRITY_KEY", "old-key", 1);
+       setenv("INTEGRITY_KEYRING", "q2:new-key,q3:k3", 1);
+       assert(loadIntegrityKeyring().size() == 3);
+       setenv("INTEGRITY_KEYRING", "0:sneaky", 1);
+       assert(loadIntegrityKeyring().empty());
+       setenv("INTEGRITY_KEYRING", "q2:new-key,q2:other-key", 1);
+       assert(loadIntegrityKeyring().empty());
+       unsetenv("INTEGRITY_KEY");
+       unsetenv("INTEGRITY_KEYRING");
+ 
+       std::remove(log.c_str());
+       std::remove((log + ".quarantine").c_str());
+   }
+ 
+   // Occupancy histogram: columnar decode + bucketed headcount
+   {
+       int64_t t = 0;
+       assert(parseTimestampSeconds("2025-10-30T12:00:00Z", t) && t == 1761825600);
+       assert(formatTimestampSeconds(t) == "2025-10-30T12:00:00Z");
+       assert(parseTimestampSeconds("2025/10/30 12:00", t) == false);
+       assert(parseTimestampSeconds("2025-02-31T10:00:00Z", t) == false);
+       assert(parseTimestampSeconds("2025-04-31T10:00:00Z", t) == false);
+       assert(parseTimestampSeconds("2025-02-29T10:00:00Z", t) == false);
+       assert(parseTimestampSeconds("2024-02-29T10:00:00Z", t) == true);  // leap year
+       assert(parseTimestampSeconds("2000-02-29T10:00:00Z", t) == true);
+       assert(parseTimestampSeconds("1900-02-29T10:00:00Z", t) == false);
+       assert(parseBucketSpec("1h") == 3600 && parseBucketSpec("15m") == 900);
+       assert(parseBucketSpec("0h") == 0 && parseBucketSpec("h") == 0 && parseBucketSpec("5x") == 0);
+ 
+       const std::string log = "histogram_test.log";
+       const std::string key = "hist-key";
+       std::remove(log.c_str());
+       auto add = [&](const char *actor, const char *action, const char *room, const char *time) {
+           assert(appendSecure(log, makeEntry(log, key, actor, action, room, time)));
+       };
+       add("guard1",  "enter", "GalleryA", "2025-10-30T10:05:00Z");
+       add("guard2",  "enter", "GalleryA", "2025-10-30T10:20:00Z");
+       add("guard1",  "exit",  "GalleryA", "2025-10-30T10:40:00Z");
+       add("guard1",  "exit",  "GalleryA", "2025-10-30T10:41:00Z"); // no matching enter
+       add("visitor", "enter", "GalleryB", "2025-10-30T11:10:00Z");
+       add("guard2",  "exit",  "GalleryA", "2025-10-30T12:30:00Z");
+       add("guard3",  "enter", "GalleryA", "2025-10-30T09:50:00Z"); // late, out of order
+       add("guard4",  "enter", "GalleryA", "2025-13-01T10:00:00Z"); // passes isValidTimestamp()
+       add("guard4",  "enter", "GalleryA", "2025-02-31T10:00:00Z"); // so does Feb 31
+ 
+       EventColumns ev;
+       decodeEvents(readAllLines(log), ev);
+       assert(ev.time.size() == 7 && ev.skipped == 2 && ev.roomNames.size() == 2);
+ 
+       // same answer whichever way the buckets are split across threads
+       for (unsigned threads : {1u, 2u, 8u}) {
+           OccupancyHistogram h;
+           assert(computeOccupancy(ev, 3600, threads, h));
+           assert(h.buckets == 4 && formatTimestampSeconds(h.origin) == "2025-10-30T09:00:00Z");
+           size_t A = 0, B = 1; // interned in first-seen order
+           assert(ev.roomNames[A] == "GalleryA" && ev.roomNames[B] == "GalleryB");
+           assert(h.peak[0 * 2 + A] == 1 && h.occupancyEnd[0 * 2 + A] == 1);
+           assert(h.peak[1 * 2 + A] == 3 && h.entries[1 * 2 + A] == 2 && h.exits[1 * 2 + A] == 1);
+           assert(h.occupancyEnd[1 * 2 + A] == 2);
+           assert(h.peak[2 * 2 + A] == 2 && h.peak[2 * 2 + B] == 1);
+           assert(h.occupancyEnd[3 * 2 + A] == 1 && h.exits[3 * 2 + A] == 1);
+       }
+ 
+       // a 1s bucket over this span is refused rather than allocated
+       OccupancyHistogram tiny;
+       EventColumns wide = ev;
+       wide.time.back() += 10LL * 365 * 86400;
+       assert(computeOccupancy(wide, 1, 1, tiny) == false);
+ 
+       // out-of-order times are replayed in time order: exit@10:00 is
+       // applied before enter@11:00, so guard5 ends up inside
+       {
+           const std::string log2 = "histogram_order.log";
+           std::remove(log2.c_str());
+           assert(appendSecure(log2, makeEntry(log2, key, "guard5", "enter", "GalleryC", "2025-10-30T11:00:00Z")));
+           assert(appendSecure(log2, makeEntry(log2, key, "guard5", "exit",  "GalleryC", "2025-10-30T10:00:00Z")));
+           EventColumns ooo;
+           decodeEvents(readAllLines(log2), ooo);
+           assert(ooo.delta[0] == 0 && ooo.delta[1] == 1);
+           std::remove(log2.c_str());
+       }
+ 
+       DwellHistogram d = computeDwell(ev, 3600);
+       assert(d.counts[0 * d.bins + 0] == 1); // guard1: 35 min
+       assert(d.counts[0 * d.bins + 2] == 1); // guard2: 2h10m
+ 
+       // rendered output, CSV and JSON, with the --room filter
+       {
+           OccupancyHistogram h;
+           assert(computeOccupancy(ev, 3600, 2, h));
+           std::ostringstream csv, json;
+           writeOccupancy(csv, h, ev, false, "GalleryB");
+           writeOccupancy(json, h, ev, true, "GalleryB");
+           assert(csv.str() ==
+                  "bucket_start,room,peak,entries,exits,occupancy_end\n"
+                  "2025-10-30T11:00:00Z,GalleryB,1,1,0,1\n"
+                  "2025-10-30T12:00:00Z,GalleryB,1,0,0,1\n");
+           assert(json.str() ==
+                  "[\n"
+                  "{\"bucket_start\":\"2025-10-30T11:00:00Z\",\"room\":\"GalleryB\",\"peak\":1,\"entries\":1,\"exits\":0,\"occupancy_end\":1},\n"
+                  "{\"bucket_start\":\"2025-10-30T12:00:00Z\",\"room\":\"GalleryB\",\"peak\":1,\"entries\":0,\"exits\":0,\"occupancy_end\":1}\n"
+                  "]\n");
+ 
+           std::ostringstream all;
+           writeOccupancy(all, h, ev, false, "");
+           assert(all.str().find("2025-10-30T09:00:00Z,GalleryA,1,1,0,1\n") != std::string::npos);
+           assert(all.str().find("2025-10-30T10:00:00Z,GalleryA,3,2,1,2\n") != std::string::npos);
+ 
+           std::ostringstream dcsv, djson, dnone;
+           writeDwell(dcsv, d, ev, false, "GalleryA");
+           writeDwell(djson, d, ev, true, "GalleryA");
+           writeDwell(dnone, d, ev, true, "GalleryB"); // visitor never left
+           assert(dcsv.str() ==
+                  "room,dwell_from_seconds,visits\n"
+                  "GalleryA,0,1\n"
+                  "GalleryA,7200,1\n");
+           assert(djson.str() ==
+                  "[\n"
+                  "{\"room\":\"GalleryA\",\"dwell_from_seconds\":0,\"visits\":1},\n"
+                  "{\"room\":\"GalleryA\",\"dwell_from_seconds\":7200,\"visits\":1}\n"
+                  "]\n");
+           assert(dnone.str() == "[\n]\n");
+       }
+ 
+       // logread --histogram argument handling
+       {
+           auto run = [&](std::vector<std::string> args) {
+               args.insert(args.begin(), "logread");
+               std::vector<char*> argv;
+               for (std::string &a : args) argv.push_back(&a[0]);
+               std::ostringstream captured, warnings;
+               std::streambuf *oldOut = std::cout.rdbuf(captured.rdbuf());
+               std::streambuf *oldErr = std::cerr.rdbuf(warnings.rdbuf());
+               HistogramResult r = runHistogramFromArgs((int)argv.size(), argv.data(),
+                                                        readAllLines(log));
+               std::cout.rdbuf(oldOut);
+               std::cerr.rdbuf(oldErr);
+               if (r == HistogramResult::Ok) {
+                   assert(warnings.str() == "Skipped 2 entries with unusable timestamps.\n");
+               }
+               return std::make_pair(r, captured.str());
+           };
+           assert(run({"--histogram", "--format", "xml"}).first  == HistogramResult::BadInput);
+           assert(run({"--histogram", "--bucket", "0h"}).first   == HistogramResult::BadInput);
+           assert(run({"--histogram", "--room", "bad$room"}).first == HistogramResult::BadInput);
+           assert(run({"--histogram", "--bucket", "1s"}).first   == HistogramResult::Ok);
+ 
+           auto ok = run({"--histogram", "--bucket", "1h", "--room", "GalleryB"});
+           assert(ok.first == HistogramResult::Ok);
+           assert(ok.second ==
+                  "bucket_start,room,peak,entries,exits,occupancy_end\n"
+                  "2025-10-30T11:00:00Z,GalleryB,1,1,0,1\n"
+                  "2025-10-30T12:00:00Z,GalleryB,1,0,0,1\n");
+           auto dwell = run({"--histogram", "--dwell", "--format", "json", "--room", "GalleryB"});
+           assert(dwell.first == HistogramResult::Ok && dwell.second == "[\n]\n");
+       }
+ 
+       std::remove(log.c_str());
    }
  
    std::cout << "PASS: All automated tests behaved as expected.\n";